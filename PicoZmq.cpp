@@ -30,8 +30,6 @@
 
 #include "PicoZmq.h"
 
-#define CLEAR_ARRAY(array) (fill_n(array, 255, 0))
-
 PicoZmq::PicoZmq(const string& remoteAddr, uint16_t remote_port, SocketTypes socket_type, uint8_t keep_alive_time): remote_port(remote_port), socketType(socket_type) {
     if(keep_alive_time > 127){
         COUT(socketType << "Keep alive time must be less then or equal to 127");
@@ -39,7 +37,7 @@ PicoZmq::PicoZmq(const string& remoteAddr, uint16_t remote_port, SocketTypes soc
     }
     keepAliveTime = keep_alive_time * 2;
 
-    queue_init(&receive_queue, sizeof(char[255]), 4);
+    queue_init(&receive_queue, sizeof(queueItem), RECEIVE_QUEUE_LENGTH);
 
     ip4addr_aton(remoteAddr.c_str(), &remote_addr);
 
@@ -76,10 +74,14 @@ PicoZmq::~PicoZmq() {
         }
         tcp_pcb = nullptr;
     }
+    if(receive_queue.data != nullptr){
+        queue_free(&receive_queue);
+    }
 }
 
 err_t PicoZmq::sendMessage(const string &message) {
     if(socketType == PUB || socketType == PUSH){
+        TRACE_TIME(uint64_t traceStart);
         char sentData[255] = {0x00};
         uint16_t messageSize = topic.size() + message.size();
         if (messageSize > 253){
@@ -95,6 +97,7 @@ err_t PicoZmq::sendMessage(const string &message) {
         cyw43_arch_lwip_begin();
         err_t err = tcp_write(tcp_pcb, sentData, messageSize + 2, TCP_WRITE_FLAG_COPY);
         tcp_output(tcp_pcb);
+        TRACE_SEND(err, traceStart);
         cyw43_arch_lwip_end();
         return err;
     }
@@ -102,6 +105,7 @@ err_t PicoZmq::sendMessage(const string &message) {
 
 err_t PicoZmq::sendMessage(const vector<char> &message) {
     if(socketType == PUB || socketType == PUSH) {
+        TRACE_TIME(uint64_t traceStart);
         char sentData[255] = {0x00};
         uint16_t messageSize = topic.size() + message.size();
         if (messageSize > 253) {
@@ -117,35 +121,106 @@ err_t PicoZmq::sendMessage(const vector<char> &message) {
         cyw43_arch_lwip_begin();
         err_t err = tcp_write(tcp_pcb, sentData, messageSize + 2, TCP_WRITE_FLAG_COPY);
         tcp_output(tcp_pcb);
+        TRACE_SEND(err, traceStart);
         cyw43_arch_lwip_end();
         return err;
     }
 }
 
 err_t PicoZmq::subscribe(const string &subTopic) {
-    if(find(subTopics.begin(), subTopics.end(), subTopic) != subTopics.end()){
+    if(subTopics.count(subTopic)){
         COUT(socketType << "Already subscribed to topic" << endl);
         return ERR_VAL;
     }
+    return subscribe(vector<string>{subTopic});
+}
+
+err_t PicoZmq::subscribe(const vector<string> &newTopics) {
+    if (!isConnected()){
+        return ERR_CONN;
+    }
+    vector<string> topics;
+    unordered_set<string> batch;
+    for (auto &newTopic: newTopics) {
+        if(!subTopics.count(newTopic) && batch.insert(newTopic).second){
+            topics.push_back(newTopic);
+        }
+    }
+    if(topics.empty()){
+        return ERR_OK;
+    }
+    if(subTopics.size() + topics.size() > 256){
+        COUT(socketType << "too many topics: " << subTopics.size() + topics.size() << " > " << 256 << endl);
+        return ERR_MEM;
+    }
+    err_t err = sendSubCommands("SUBSCRIBE", topics);
+    if(err == ERR_OK){
+        for (auto &newTopic: topics) {
+            uint8_t topicID = nextTopicID();
+            subTopics[newTopic] = topicID;
+            topicLengths[newTopic.size()] ++;
+        }
+    }
+    return err;
+}
+
+err_t PicoZmq::unsubscribe(const string &subTopic) {
+    if(!subTopics.count(subTopic)){
+        COUT(socketType << "Not subscribed to topic" << endl);
+        return ERR_VAL;
+    }
+    return unsubscribe(vector<string>{subTopic});
+}
+
+err_t PicoZmq::unsubscribe(const vector<string> &oldTopics) {
+    vector<string> topics;
+    unordered_set<string> batch;
+    for (auto &oldTopic: oldTopics) {
+        if(subTopics.count(oldTopic) && batch.insert(oldTopic).second){
+            topics.push_back(oldTopic);
+        }
+    }
+    if(topics.empty()){
+        return ERR_OK;
+    }
     if (isConnected()){
-        err_t err = sendSub(subTopic);
-        if(err == ERR_OK){
-            subTopics.push_back(subTopic);
+        err_t err = sendSubCommands("CANCEL", topics);
+        if(err != ERR_OK){
+            return err;
         }
-        return err;
     }
-    return ERR_CONN;
+    for (auto &oldTopic: topics) {
+        freeTopicIDs.push_back(subTopics[oldTopic]);
+        subTopics.erase(oldTopic);
+        if(-- topicLengths[oldTopic.size()] == 0){
+            topicLengths.erase(oldTopic.size());
+        }
+    }
+    return ERR_OK;
 }
 
 PicoZmq::returnMessage PicoZmq::getMessage() {
     if(!gotMessage()){return {};}
-    vector<char> rec_data_tmp (255, 0);
-    queue_try_remove(&receive_queue, rec_data_tmp.data());
-    string message(rec_data_tmp.begin() + 2, rec_data_tmp.begin() + rec_data_tmp[1] + 2);
-    for (uint8_t i = 0; i < (uint8_t) subTopics.size(); ++i) {
-        if(message.find(subTopics[i]) != string::npos){
-            vector<char> payload(rec_data_tmp.begin() + (int) subTopics[i].size() + 2, rec_data_tmp.begin() + rec_data_tmp[1] + 2);
-            return {i, payload};
+    queueItem item{};
+    queue_try_remove(&receive_queue, &item);
+    TRACE_RECORD(latency.stages[QUEUE_WAIT], item.enqueueTime, time_us_64());
+    const char *rec_data_tmp = item.data;
+    uint8_t messageSize = rec_data_tmp[1];
+    if(item.len < 2 || messageSize > item.len - 2){
+        COUT(socketType << "received incomplete message: " << (int) item.len << " bytes" << endl);
+        return {};
+    }
+    string prefix;
+    prefix.reserve(messageSize);
+    for (auto &topicLength: topicLengths) {
+        if(topicLength.first > messageSize){
+            continue;
+        }
+        prefix.assign(rec_data_tmp + 2, topicLength.first);
+        auto match = subTopics.find(prefix);
+        if(match != subTopics.end()){
+            vector<char> payload(rec_data_tmp + topicLength.first + 2, rec_data_tmp + messageSize + 2);
+            return {match->second, payload, true};
         }
     }
     return {};
@@ -182,13 +257,22 @@ void PicoZmq::reconnect() {
 
         if(socketType == SUB && connected){
             COUT(socketType << "sending sub message" << endl);
+            vector<string> topics;
+            topics.reserve(subTopics.size());
             for (auto &subTopic: subTopics) {
-                err = sendSub(subTopic);
-                if(err != ERR_OK){
-                    return;
-                }
+                topics.push_back(subTopic.first);
+            }
+            err = sendSubCommands("SUBSCRIBE", topics);
+            if(err != ERR_OK){
+                COUT(socketType << "error sending sub message err code: " << (int) err << endl);
+                connected = false;
+                cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, true);
+                lastReconnectAttempt = time_us_64();
+                reconnectTimeout = RECONNECT_DEFAULT_TIMEOUT * (reconnectCount < 12 ? reconnectCount : 12);
+                return;
             }
         }
+        reconnectCount = 0;
     }
 }
 
@@ -208,9 +292,7 @@ err_t PicoZmq::tcp_client_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p,
             for (struct pbuf *q = p; q != nullptr; q = q->next){
                 DUMP_MESSAGE_BYTES((uint8_t*) q->payload, q->len, tcp_data->socketType);
             }
-            char rec_data_tmp[255] = {0};
-            pbuf_copy_partial(p, rec_data_tmp, p->tot_len, 0);
-            if(! queue_try_add(tcp_data->receive_queue, rec_data_tmp)){COUT(tcp_data->socketType << "failed to add to que" << endl);}
+            decodeFrames(tcp_data, p);
             tcp_recved(tpcb, p->tot_len);
         }
     }
@@ -235,6 +317,106 @@ err_t PicoZmq::tcp_client_poll(void *arg, struct tcp_pcb *tpcb) {
     return err;
 }
 
+#if LATENCY_TRACE
+err_t PicoZmq::tcp_client_sent(void *arg, struct tcp_pcb *tpcb, u16_t) {
+    auto *tcp_data = (tcpData*) arg;
+    latencyTrace *trace = tcp_data->latency;
+    uint64_t now = time_us_64();
+    while (trace->pendingCount > 0 && (int32_t) (tpcb->lastack - trace->pendingSeq[trace->pendingHead]) >= 0){
+        recordLatency(trace->stages[SEND_ACK], trace->pendingTime[trace->pendingHead], now);
+        trace->pendingHead = (trace->pendingHead + 1) % LATENCY_TRACE_PENDING;
+        trace->pendingCount --;
+    }
+    return ERR_OK;
+}
+
+void PicoZmq::recordLatency(latencyHistogram &hist, uint64_t start, uint64_t end) {
+    uint64_t latencyUs = end - start;
+    uint8_t bucket = latencyUs == 0 ? 0 : 64 - __builtin_clzll(latencyUs);
+    hist.buckets[bucket < 32 ? bucket : 31] ++;
+    hist.count ++;
+    hist.total += latencyUs;
+    if(latencyUs > hist.max){
+        hist.max = latencyUs > UINT32_MAX ? UINT32_MAX : latencyUs;
+    }
+}
+
+void PicoZmq::traceSend(err_t err, uint64_t start) {
+    uint64_t now = time_us_64();
+    recordLatency(latency.stages[SEND_WRITE], start, now);
+    if(err != ERR_OK || latency.pendingCount == LATENCY_TRACE_PENDING){
+        return;
+    }
+    uint8_t index = (latency.pendingHead + latency.pendingCount) % LATENCY_TRACE_PENDING;
+    latency.pendingSeq[index] = tcp_pcb->snd_lbb;
+    latency.pendingTime[index] = now;
+    latency.pendingCount ++;
+}
+
+PicoZmq::latencyHistogram PicoZmq::getLatency(LatencyStages stage) {
+    cyw43_arch_lwip_begin();
+    latencyHistogram hist = latency.stages[stage];
+    cyw43_arch_lwip_end();
+    return hist;
+}
+
+void PicoZmq::resetLatency() {
+    cyw43_arch_lwip_begin();
+    fill_n(latency.stages, LATENCY_STAGES, latencyHistogram{});
+    cyw43_arch_lwip_end();
+}
+#endif
+
+void PicoZmq::decodeFrames(tcpData *tcp_data, const struct pbuf *p) {
+    frameDecoder &decoder = *tcp_data->decoder;
+    queueItem &item = decoder.item;
+    uint16_t offset = 0;
+    while (offset < p->tot_len){
+        if(decoder.skip > 0){
+            uint16_t skipped = decoder.skip < (uint64_t) (p->tot_len - offset) ? decoder.skip : p->tot_len - offset;
+            decoder.skip -= skipped;
+            offset += skipped;
+            continue;
+        }
+        if(item.len == 0){
+            TRACE_TIME(item.recvTime);
+            decoder.needed = decoder.greeting ? 64 : 2;
+        }
+        uint16_t copy = decoder.needed - item.len < p->tot_len - offset ? decoder.needed - item.len : p->tot_len - offset;
+        item.len += pbuf_copy_partial(p, item.data + item.len, copy, offset);
+        offset += copy;
+        if(item.len < decoder.needed){
+            continue;
+        }
+        if(!decoder.greeting && item.data[0] & 0x02){
+            // long frame, does not fit in a queue item
+            if(decoder.needed == 2){
+                decoder.needed = 9;
+                continue;
+            }
+            for (uint8_t i = 1; i < 9; ++i) {
+                decoder.skip = (decoder.skip << 8) | (uint8_t) item.data[i];
+            }
+            COUT(tcp_data->socketType << "dropped frame of " << decoder.skip << " bytes" << endl);
+            decoder.dropped ++;
+            item.len = 0;
+            continue;
+        }
+        if(!decoder.greeting && decoder.needed == 2 && item.data[1] != 0){
+            decoder.needed = 2 + (uint8_t) item.data[1];
+            continue;
+        }
+        decoder.greeting = false;
+        TRACE_TIME(item.enqueueTime);
+        if(! queue_try_add(tcp_data->receive_queue, &item)){
+            COUT(tcp_data->socketType << "failed to add to que" << endl);
+            decoder.dropped ++;
+        }
+        else{TRACE_RECORD(tcp_data->latency->stages[RECV_TO_ENQUEUE], item.recvTime, item.enqueueTime);}
+        item.len = 0;
+    }
+}
+
 bool PicoZmq::queue_remove_timeout(queue_t *q, void *data, clock_t timout) {
     clock_t startTime = time_us_64();
     timout *= 1000;
@@ -247,26 +429,68 @@ bool PicoZmq::queue_remove_timeout(queue_t *q, void *data, clock_t timout) {
     return true;
 }
 
-err_t PicoZmq::sendSub(const string& subTopic) {
-    uint16_t subTopicSize = subTopic.size() + 10;
-    if (subTopicSize > 253){
-        COUT(socketType << "message to long: " << (int) subTopicSize << " > " << 253);
-        return ERR_VAL;
+err_t PicoZmq::sendSubCommands(const string &command, const vector<string> &topics, clock_t timeout) {
+    vector<char> sentData;
+    for (auto &subTopic: topics) {
+        size_t commandSize = command.size() + subTopic.size() + 1;
+        if (commandSize > 255){
+            COUT(socketType << "message to long: " << commandSize << " > " << 255);
+            return ERR_VAL;
+        }
+        sentData.push_back(0x04);
+        sentData.push_back((char) commandSize);
+        sentData.push_back((char) command.size());
+        sentData.insert(sentData.end(), command.begin(), command.end());
+        sentData.insert(sentData.end(), subTopic.begin(), subTopic.end());
+    }
+    if (sentData.empty()){
+        return ERR_OK;
     }
-    char sentData[255] = {0x00};
-    sentData[0] = 0x04;
-    sentData[1] = subTopicSize;
-    sentData[2] = 0x09;
-    sentData[3] = 'S'; sentData[4] = 'U'; sentData[5] = 'B'; sentData[6] = 'S'; sentData[7] = 'C'; sentData[8] = 'R'; sentData[9] = 'I'; sentData[10] = 'B'; sentData[11] = 'E';
-    strcpy(sentData + 12, subTopic.c_str());
     COUT_MESSAGE(socketType << "sending:");
-    DUMP_MESSAGE_BYTES((uint8_t*) sentData, subTopicSize + 2, &socketType);
+    DUMP_MESSAGE_BYTES((uint8_t*) sentData.data(), sentData.size(), &socketType);
 
-    cyw43_arch_lwip_begin();
-    err_t err = tcp_write(tcp_pcb, sentData, subTopicSize + 2, TCP_WRITE_FLAG_COPY);
-    tcp_output(tcp_pcb);
-    cyw43_arch_lwip_end();
-    return err;
+    size_t offset = 0;
+    uint64_t startTime = time_us_64();
+    while (offset < sentData.size()){
+        cyw43_arch_lwip_begin();
+        size_t chunkSize = sentData.size() - offset < tcp_sndbuf(tcp_pcb) ? sentData.size() - offset : tcp_sndbuf(tcp_pcb);
+        err_t err = ERR_MEM;
+        if(chunkSize > 0 && tcp_sndqueuelen(tcp_pcb) < TCP_SND_QUEUELEN){
+            bool last = offset + chunkSize == sentData.size();
+            err = tcp_write(tcp_pcb, sentData.data() + offset, chunkSize, TCP_WRITE_FLAG_COPY | (last ? 0 : TCP_WRITE_FLAG_MORE));
+        }
+        if(err == ERR_OK){
+            offset += chunkSize;
+        }
+        if(err != ERR_OK || offset == sentData.size()){
+            tcp_output(tcp_pcb);
+        }
+        cyw43_arch_lwip_end();
+
+        if(err == ERR_MEM && time_us_64() - startTime <= (uint64_t) timeout * 1000){
+            // wait for the server to acknowledge earlier data
+            sleep_ms(10);
+        }
+        else if(err != ERR_OK){
+            COUT(socketType << "could not write sub message, err code: " << (int) err << " after " << offset << " of " << sentData.size() << " bytes" << endl);
+            if(offset > 0){
+                connected = false;
+                cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, true);
+            }
+            return err;
+        }
+    }
+    return ERR_OK;
+}
+
+uint8_t PicoZmq::nextTopicID() {
+    if(freeTopicIDs.empty()){
+        return subTopics.size();
+    }
+    auto lowest = min_element(freeTopicIDs.begin(), freeTopicIDs.end());
+    uint8_t topicID = *lowest;
+    freeTopicIDs.erase(lowest);
+    return topicID;
 }
 
 err_t PicoZmq::settingUpTcpPcb() {
@@ -276,6 +500,20 @@ err_t PicoZmq::settingUpTcpPcb() {
     tcp_data.receive_queue = &receive_queue;
     tcp_data.socketType = &socketType;
     tcp_data.connected = &connected;
+    tcp_data.decoder = &decoder;
+
+    // a new connection starts with a greeting, anything left from the old one is stale
+    uint32_t dropped = decoder.dropped;
+    decoder = {};
+    decoder.greeting = true;
+    decoder.dropped = dropped;
+    queueItem item{};
+    while (queue_try_remove(&receive_queue, &item)){}
+#if LATENCY_TRACE
+    tcp_data.latency = &latency;
+    latency.pendingCount = 0;
+    tcp_sent(tcp_pcb, tcp_client_sent);
+#endif
 
     tcp_arg(tcp_pcb, &tcp_data);
     tcp_recv(tcp_pcb, tcp_client_recv);
@@ -291,6 +529,12 @@ err_t PicoZmq::settingUpTcpPcb() {
 }
 
 err_t PicoZmq::closeTcpPcb() {
+    tcp_arg(tcp_pcb, nullptr);
+    tcp_poll(tcp_pcb, nullptr, 0);
+    tcp_sent(tcp_pcb, nullptr);
+    tcp_recv(tcp_pcb, nullptr);
+    tcp_err(tcp_pcb, nullptr);
+
     cyw43_arch_lwip_begin();
     err_t err = tcp_close(tcp_pcb);
     cyw43_arch_lwip_end();
@@ -298,43 +542,33 @@ err_t PicoZmq::closeTcpPcb() {
 }
 
 err_t PicoZmq::connectToZmq() {
-    char rec_data_tmp[255];
+    queueItem item{};
     //greeting
-    if(! queue_remove_timeout(&receive_queue, &rec_data_tmp)){
+    if(! queue_remove_timeout(&receive_queue, &item)){
         connected = false;
         cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, true);
         return ERR_TIMEOUT;
     }
-    if(!(rec_data_tmp[12] == 'N' && rec_data_tmp[13] == 'U' && rec_data_tmp[14] == 'L' && rec_data_tmp[15] == 'L')){
-        CLEAR_ARRAY(rec_data_tmp);
-        if(! queue_remove_timeout(&receive_queue, &rec_data_tmp)){
-            connected = false;
-            cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, true);
-            return ERR_TIMEOUT;
-        }
-        if(!(rec_data_tmp[2] == 'N' && rec_data_tmp[3] == 'U' && rec_data_tmp[4] == 'L' && rec_data_tmp[5] == 'L')){
-            COUT(socketType << "received wrong greeting" << endl);
-            connected = false;
-            cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, true);
-            return ERR_CONN;
-        }
+    if(!checkGreeting(item)){
+        COUT(socketType << "received wrong greeting" << endl);
+        connected = false;
+        cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, true);
+        return ERR_CONN;
     }
 
     //ready
-    CLEAR_ARRAY(rec_data_tmp);
-    if(! queue_remove_timeout(&receive_queue, &rec_data_tmp)){
+    if(! queue_remove_timeout(&receive_queue, &item)){
         connected = false;
         cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, true);
         return ERR_TIMEOUT;
     }
-    if(rec_data_tmp[0] != 0x04 || ! (rec_data_tmp[2] == 0x05 && rec_data_tmp[3] == 'R' && rec_data_tmp[4] == 'E' && rec_data_tmp[5] == 'A' && rec_data_tmp[6] == 'D' && rec_data_tmp[7] == 'Y') || ! (rec_data_tmp[8] == 0x0b && rec_data_tmp[9] == 'S' && rec_data_tmp[10] == 'o' && rec_data_tmp[11] == 'c' && rec_data_tmp[12] == 'k' && rec_data_tmp[13] == 'e' && rec_data_tmp[14] == 't' && rec_data_tmp[15] == '-' && rec_data_tmp[16] == 'T' && rec_data_tmp[17] == 'y' && rec_data_tmp[18] == 'p' && rec_data_tmp[19] == 'e')){
+    string socketTypeRec;
+    if(!parseReady(item, socketTypeRec)){
         COUT(socketType << "socket not ready" << endl);
         connected = false;
         cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, true);
         return ERR_CONN;
     }
-
-    string socketTypeRec(rec_data_tmp + 24, rec_data_tmp[23]);
 //    cout << "socket type server: " << socketTypeRec << endl;
 
     if(socketTypeRec != names[socketType % 2 ? socketType - 1: socketType + 1]){
@@ -354,7 +588,6 @@ err_t PicoZmq::connectToZmq() {
 
     COUT(socketType << "connected to ZMQ broker" << endl);
     connected = true;
-    reconnectCount = 0;
     return ERR_OK;
 }
 
@@ -408,6 +641,24 @@ err_t PicoZmq::sendReadyMessage() {
     return err;
 }
 
+bool PicoZmq::checkGreeting(const queueItem &item) {
+    const char *rec_data_tmp = item.data;
+    return item.len == 64 && (uint8_t) rec_data_tmp[0] == 0xFF && rec_data_tmp[10] == 0x03 && rec_data_tmp[12] == 'N' && rec_data_tmp[13] == 'U' && rec_data_tmp[14] == 'L' && rec_data_tmp[15] == 'L';
+}
+
+bool PicoZmq::parseReady(const queueItem &item, string &socketTypeRec) {
+    const char *rec_data_tmp = item.data;
+    if(item.len < 24 || rec_data_tmp[0] != 0x04 || ! (rec_data_tmp[2] == 0x05 && rec_data_tmp[3] == 'R' && rec_data_tmp[4] == 'E' && rec_data_tmp[5] == 'A' && rec_data_tmp[6] == 'D' && rec_data_tmp[7] == 'Y') || ! (rec_data_tmp[8] == 0x0b && rec_data_tmp[9] == 'S' && rec_data_tmp[10] == 'o' && rec_data_tmp[11] == 'c' && rec_data_tmp[12] == 'k' && rec_data_tmp[13] == 'e' && rec_data_tmp[14] == 't' && rec_data_tmp[15] == '-' && rec_data_tmp[16] == 'T' && rec_data_tmp[17] == 'y' && rec_data_tmp[18] == 'p' && rec_data_tmp[19] == 'e')){
+        return false;
+    }
+    uint8_t socketTypeSize = rec_data_tmp[23];
+    if(socketTypeSize > item.len - 24){
+        return false;
+    }
+    socketTypeRec.assign(rec_data_tmp + 24, socketTypeSize);
+    return true;
+}
+
 #if DEBUG_MESSAGE
 void PicoZmq::dump_bytes(const uint8_t *bptr, const uint32_t len, const SocketTypes *socketType) {
     cout << socketType << "debug bytes " << len ;
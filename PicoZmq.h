@@ -35,6 +35,9 @@
 #include <array>
 #include <iostream>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
 #include <iomanip>
 #include <algorithm>
 #include "lwip/pbuf.h"
@@ -44,6 +47,10 @@
 
 #define RECONNECT_DEFAULT_TIMEOUT (5 * 1000 * 1000)
 
+#ifndef RECEIVE_QUEUE_LENGTH
+    #define RECEIVE_QUEUE_LENGTH 8
+#endif
+
 #if DEBUG
     #define COUT(str) cout << str
 #else
@@ -58,6 +65,17 @@
     #define COUT_MESSAGE(str)
 #endif
 
+#if LATENCY_TRACE
+    #define LATENCY_TRACE_PENDING 8
+    #define TRACE_TIME(var) var = time_us_64()
+    #define TRACE_RECORD(hist, start, end) recordLatency(hist, start, end)
+    #define TRACE_SEND(err, start) traceSend(err, start)
+#else
+    #define TRACE_TIME(var)
+    #define TRACE_RECORD(hist, start, end)
+    #define TRACE_SEND(err, start)
+#endif
+
 
 using namespace std;
 
@@ -72,8 +90,9 @@ public:
      * Struct containing data of message
      */
     struct returnMessage{
-        uint8_t topicID;        /**< id of topic in topic vector */
+        uint8_t topicID;        /**< id of topic, assigned in order of subscription. IDs freed by unsubscribe are reused */
         vector<char> payload;   /**< payload of message */
+        bool matched;           /**< false when there was no message or no subscribed topic matched */
     };
 
     /**
@@ -86,6 +105,30 @@ public:
         PULL = 3,
     };
 
+#if LATENCY_TRACE
+    /**
+     * enum containing the traced latency stages
+     */
+    enum LatencyStages{
+        RECV_TO_ENQUEUE = 0,    /**< pbuf arrival in the tcp callback until insertion in the queue */
+        QUEUE_WAIT = 1,         /**< insertion in the queue until removal by getMessage */
+        SEND_WRITE = 2,         /**< call of sendMessage until tcp_write and tcp_output returned */
+        SEND_ACK = 3,           /**< tcp_write until the data is acknowledged by the server */
+        LATENCY_STAGES = 4,     /**< number of traced stages */
+    };
+
+    /**
+     * Struct containing a log2 histogram of latencies in us.
+     * Bucket 0 counts latencies of 0 us, bucket i counts latencies in [2^(i-1), 2^i) us
+     */
+    struct latencyHistogram{
+        uint32_t buckets[32];   /**< number of samples per bucket, the last bucket also holds all larger samples */
+        uint32_t count;         /**< total number of samples */
+        uint32_t max;           /**< largest sample in us */
+        uint64_t total;         /**< sum of all samples in us */
+    };
+#endif
+
     /**
      * Create new socket
      * @brief Constructor
@@ -144,8 +187,37 @@ public:
     err_t subscribe(const string &subTopic);
 
     /**
-     * Get first message from que
-     * @return Message struct with topic ID and payload
+     * Subscribes to multiple topics with a single tcp write. Topics that are already subscribed are skipped
+     * @param newTopics vector with the topics
+     * @return ERR_OK if subscribed, another err_t on error
+     */
+    err_t subscribe(const vector<string> &newTopics);
+
+    /**
+     * Unsubscribes from topic so the server stops sending it. When not connected the topic is only removed locally
+     * @param subTopic string with the topic
+     * @return ERR_OK if unsubscribed, another err_t on error
+     */
+    err_t unsubscribe(const string &subTopic);
+
+    /**
+     * Unsubscribes from multiple topics with a single tcp write. Topics that are not subscribed are skipped
+     * @param oldTopics vector with the topics
+     * @return ERR_OK if unsubscribed, another err_t on error
+     */
+    err_t unsubscribe(const vector<string> &oldTopics);
+
+    /**
+     * Number of received frames that were dropped, because they were longer than 255 bytes or the queue was full
+     * @return number of dropped frames since the socket was created
+     */
+    [[nodiscard]] uint32_t getDroppedFrames() const{return decoder.dropped;}
+
+    /**
+     * Get first message from que. A message matches a topic when it starts with the topic, like ZMQ subscriptions.
+     * When multiple subscribed topics match, the longest one is used, e.g. "weather/temp" before "weather".
+     * The payload is the message without the matched topic
+     * @return Message struct with topic ID and payload, empty struct with matched false when no subscribed topic matches
      */
     returnMessage getMessage();
 
@@ -154,11 +226,42 @@ public:
      */
     void reconnect();
 
+#if LATENCY_TRACE
+    /**
+     * Get a copy of the latency histogram of a stage
+     * @param stage the stage to get the histogram of
+     * @return histogram with all samples since the last reset
+     */
+    latencyHistogram getLatency(LatencyStages stage);
+
+    /**
+     * Clear the latency histograms of all stages
+     */
+    void resetLatency();
+#endif
+
+#if PICOZMQ_HARNESS
+    friend class PicoZmqHarness;
+#endif
+
 #if DEBUG || DEBUG_MESSAGE
     friend ostream& operator<<(ostream& out, PicoZmq::SocketTypes value);
     friend ostream& operator<<(ostream& out,const PicoZmq::SocketTypes *value);
 #endif
 private:
+    /// item stored in the receive queue, holds the greeting or one short frame
+    struct queueItem{
+        char data[2 + 255];             /// received bytes
+        uint16_t len;                   /// number of valid bytes in data
+#if LATENCY_TRACE
+        uint64_t recvTime;              /// time in us the pbuf arrived
+        uint64_t enqueueTime;           /// time in us the item was put in the queue
+#endif
+    };
+
+    /// data given to the callback functions
+    struct tcpData;
+
     /**
      * Callback function when tcp gets an error
      */
@@ -179,6 +282,35 @@ private:
      */
     static err_t tcp_client_poll(void *arg, struct tcp_pcb *tpcb);
 
+    /**
+     * split the received tcp stream in the greeting and frames and put them in the queue
+     * @param tcp_data data of the socket that received the pbuf
+     * @param p received pbuf chain
+     */
+    static void decodeFrames(tcpData *tcp_data, const struct pbuf *p);
+
+#if LATENCY_TRACE
+    /**
+     * Callback function when sent data is acknowledged by the server
+     */
+    static err_t tcp_client_sent(void *arg, struct tcp_pcb *tpcb, u16_t len);
+
+    /**
+     * add a latency sample to a histogram
+     * @param hist histogram to add the sample to
+     * @param start time in us the stage started
+     * @param end time in us the stage ended
+     */
+    static void recordLatency(latencyHistogram &hist, uint64_t start, uint64_t end);
+
+    /**
+     * record the send latency and remember the write to time its acknowledgement, must be called with lwip locked
+     * @param err return code of tcp_write
+     * @param start time in us sendMessage was called
+     */
+    void traceSend(err_t err, uint64_t start);
+#endif
+
     /**
      * remove item from the queue with a given timeout
      * @param q pointer to the que
@@ -189,11 +321,20 @@ private:
     static bool queue_remove_timeout(queue_t *q, void *data, clock_t timout = 5000);
 
     /**
-     * send subscribe message
-     * @param subTopic topic to subscribe to
-     * @return ERR_OK when start succesfuly send, another err_t on error
+     * send subscribe or cancel commands for all topics, written in chunks that fit the tcp send buffer and sent with a single tcp output.
+     * When the send buffer stays full the socket is marked disconnected, because a command may be partially written
+     * @param command name of the command, SUBSCRIBE or CANCEL
+     * @param topics topics to send the command for
+     * @param timeout timeout in ms to wait for space in the send buffer
+     * @return ERR_OK when succesfuly send, another err_t on error
      */
-    err_t sendSub(const string& subTopic);
+    err_t sendSubCommands(const string &command, const vector<string> &topics, clock_t timeout = 5000);
+
+    /**
+     * get the topic ID for a new subscription, the lowest freed ID is reused first
+     * @return unused topic ID
+     */
+    uint8_t nextTopicID();
 
     /**
      * Setting up TCP PCB with earlier given parameters and connect to TCP server
@@ -227,6 +368,21 @@ private:
      */
     err_t sendReadyMessage();
 
+    /**
+     * Check if a received item is a ZMQ 3 greeting with the NULL security mechanism
+     * @param item received item
+     * @return true when the item is a complete greeting with the NULL mechanism
+     */
+    static bool checkGreeting(const queueItem &item);
+
+    /**
+     * Parse the Ready part of the ZMQ handshake
+     * @param item received item
+     * @param socketTypeRec string to put the socket type of the server in
+     * @return true when the item is a complete ready command, false otherwise
+     */
+    static bool parseReady(const queueItem &item, string &socketTypeRec);
+
     /// IP address of ZMQ Server
     ip_addr_t remote_addr{};
     /// Port of ZMQ Server
@@ -236,12 +392,36 @@ private:
     /// Time between keep alive/check connection messages
     uint8_t keepAliveTime = 0;
 
+#if LATENCY_TRACE
+    /// latency histograms and writes waiting for acknowledgement
+    struct latencyTrace{
+        latencyHistogram stages[LATENCY_STAGES];        /// histogram per stage
+        uint32_t pendingSeq[LATENCY_TRACE_PENDING];     /// sequence number following each unacknowledged write
+        uint64_t pendingTime[LATENCY_TRACE_PENDING];    /// time in us of each unacknowledged write
+        uint8_t pendingHead;                            /// index of the oldest unacknowledged write
+        uint8_t pendingCount;                           /// number of unacknowledged writes
+    }latency{};
+#endif
+
+    /// state of the decoder that splits the received tcp stream in the greeting and frames
+    struct frameDecoder{
+        queueItem item;                 /// greeting or frame being received
+        uint16_t needed;                /// number of bytes of the item known so far
+        uint64_t skip;                  /// bytes left to discard of a dropped frame
+        bool greeting;                  /// true until the 64 byte greeting is received
+        uint32_t dropped;               /// number of dropped frames
+    }decoder{};
+
     /// Queue where received messages are put in
     queue_t receive_queue{};
     /// publish prefix
     string topic;
-    /// vector with subscribed topics
-    vector <string> subTopics;
+    /// map with subscribed topics and their topic ID
+    unordered_map<string, uint8_t> subTopics;
+    /// topic IDs freed by unsubscribe
+    vector<uint8_t> freeTopicIDs;
+    /// number of subscribed topics per topic length, longest first
+    map<uint16_t, uint16_t, greater<>> topicLengths;
 
     /// flag that hold connection status of socket
     bool connected = false;
@@ -259,6 +439,10 @@ private:
         SocketTypes *socketType;        /// socket type of current socket
         queue_t *receive_queue;         /// que to put received messages in
         bool *connected;                /// the connected variable
+        frameDecoder *decoder;          /// decoder of the received stream
+#if LATENCY_TRACE
+        latencyTrace *latency;          /// latency histograms of the socket
+#endif
     }tcp_data{};
 
 #if DEBUG_MESSAGE
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""
+Record ZMTP byte streams sent by a libzmq peer to a PicoZmq style client.
+
+A pyzmq socket is bound on localhost and a raw tcp socket connects to it, sending the same greeting, READY and
+SUBSCRIBE commands as PicoZmq. Everything the libzmq peer sends back is written to a capture file that can be
+replayed with picozmq_replay.
+
+usage: capture.py [output directory]
+"""
+
+import socket
+import sys
+import time
+from pathlib import Path
+
+import zmq
+
+
+def greeting():
+    data = bytearray(64)
+    data[0] = 0xFF
+    data[9] = 0x7F
+    data[10] = 0x03
+    data[11] = 0x01
+    data[12:16] = b"NULL"
+    return bytes(data)
+
+
+def command(name, body):
+    size = 1 + len(name) + len(body)
+    return bytes([0x04, size, len(name)]) + name + body
+
+
+def ready(socket_type):
+    name = b"Socket-Type"
+    value = socket_type.encode()
+    return command(b"READY", bytes([len(name)]) + name + len(value).to_bytes(4, "big") + value)
+
+
+def record(server_type, client_type, subscribe, messages, path):
+    context = zmq.Context()
+    server = context.socket(server_type)
+    port = server.bind_to_random_port("tcp://127.0.0.1")
+
+    client = socket.create_connection(("127.0.0.1", port))
+    # like PicoZmq each step is a separate write after the previous one was handled by the peer
+    client.sendall(greeting())
+    time.sleep(0.1)
+    client.sendall(ready(client_type))
+    time.sleep(0.1)
+    for topic in subscribe:
+        client.sendall(command(b"SUBSCRIBE", topic))
+    # give the peer time to handle the subscriptions before publishing
+    time.sleep(0.5)
+
+    for message in messages:
+        if isinstance(message, list):
+            server.send_multipart(message)
+        else:
+            server.send(message)
+
+    client.settimeout(0.5)
+    captured = bytearray()
+    try:
+        while True:
+            data = client.recv(65536)
+            if not data:
+                break
+            captured += data
+    except socket.timeout:
+        pass
+
+    client.close()
+    server.close(linger=0)
+    context.term()
+    path.write_bytes(captured)
+    print(f"{path}: {len(captured)} bytes")
+
+
+def main():
+    out = Path(sys.argv[1]) if len(sys.argv) > 1 else Path(__file__).parent / "captures"
+    out.mkdir(parents=True, exist_ok=True)
+
+    topics = [b"weather", b"weather/temp", b"news", b"x"]
+    pub_messages = []
+    for i in range(200):
+        topic = topics[i % len(topics)]
+        pub_messages.append(topic + b" " + str(i).encode() * (1 + i % 9))
+    pub_messages.append(b"weather/temp " + b"t" * (253 - 13))    # largest frame PicoZmq can send
+    pub_messages.append(b"news " + b"n" * (255 - 5))              # largest short frame
+    pub_messages.append(b"news " + b"l" * 300)                    # long frame, dropped by the decoder
+    pub_messages.append(b"")
+    pub_messages.append([b"weather", b"multipart payload"])
+    record(zmq.PUB, "SUB", [b""], pub_messages, out / "pub_topics.zmtp")
+
+    push_messages = [b"job " + str(i).encode() * (1 + i % 40) for i in range(100)]
+    record(zmq.PUSH, "PULL", [], push_messages, out / "push_jobs.zmtp")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,22 @@
+/**
+ * @file libFuzzer target for the receive and handshake paths of PicoZmq
+ *
+ * The last two bytes of the input select the segment size and pbuf size, so captured streams can be used as corpus.
+ * The rest is delivered through tcp_client_recv, after which connectToZmq and getMessage consume it.
+ */
+
+#include "harness.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static PicoZmqHarness sub(PicoZmq::SUB, {"", "weather", "weather/temp"});
+    static PicoZmqHarness pull(PicoZmq::PULL, {""});
+    if(size < 2){
+        return 0;
+    }
+    uint8_t segmentSize = data[size - 2];
+    uint8_t pbufSize = data[size - 1];
+    splitPattern pattern{"fuzz", segmentSize, (uint16_t) (pbufSize >> 1), segmentSize};
+    PicoZmqHarness &harness = pbufSize & 1 ? pull : sub;
+    harness.replay(data, size - 2, pattern);
+    return 0;
+}
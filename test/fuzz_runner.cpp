@@ -0,0 +1,62 @@
+/**
+ * @file Runs the fuzz target without libFuzzer over the given inputs and random mutations of them
+ *
+ * usage: picozmq_fuzz_runner [--mutations N] [--seed S] input...
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int main(int argc, char **argv) {
+    unsigned long mutations = 1000;
+    unsigned long seed = 1;
+    vector<vector<uint8_t>> inputs;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if(arg == "--mutations" && i + 1 < argc){mutations = strtoul(argv[++i], nullptr, 10);}
+        else if(arg == "--seed" && i + 1 < argc){seed = strtoul(argv[++i], nullptr, 10);}
+        else{
+            ifstream file(arg, ios::binary);
+            if(!file){
+                fprintf(stderr, "could not read %s\n", arg.c_str());
+                return 2;
+            }
+            inputs.emplace_back((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        }
+    }
+    if(inputs.empty()){
+        fprintf(stderr, "usage: picozmq_fuzz_runner [--mutations N] [--seed S] input...\n");
+        return 2;
+    }
+
+    for (auto &input: inputs) {
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+
+    mt19937 random(seed);
+    for (unsigned long i = 0; i < mutations; ++i) {
+        vector<uint8_t> input = inputs[random() % inputs.size()];
+        unsigned int edits = 1 + random() % 8;
+        for (unsigned int j = 0; j < edits && !input.empty(); ++j) {
+            size_t position = random() % input.size();
+            switch (random() % 4) {
+                case 0: input[position] = random(); break;
+                case 1: input[position] ^= 1 << (random() % 8); break;
+                case 2: input.insert(input.begin() + position, random() % 4 ? (uint8_t) random() : 0xFF); break;
+                default: input.erase(input.begin() + position, input.begin() + min(input.size(), position + 1 + random() % 16)); break;
+            }
+        }
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    printf("ran %zu inputs and %lu mutations\n", inputs.size(), mutations);
+    return 0;
+}
@@ -0,0 +1,156 @@
+/**
+ * @file Host harness that replays ZMTP byte streams into PicoZmq
+ */
+
+#include "harness.h"
+#include <random>
+#include "stub_control.h"
+
+bool splitPattern::parse(const string &text, splitPattern &pattern) {
+    pattern = {text, 1460, 0, 0};
+    size_t colon = text.find(':');
+    string kind = text.substr(0, colon);
+    unsigned long value = 0;
+    if(colon != string::npos){
+        char *end = nullptr;
+        value = strtoul(text.c_str() + colon + 1, &end, 10);
+        if(*end != '\0'){
+            return false;
+        }
+    }
+    if(kind == "mss" && colon == string::npos){
+        return true;
+    }
+    if(kind == "bytes" && colon == string::npos){
+        pattern.segmentSize = 1;
+        return true;
+    }
+    if(kind == "fixed" && value > 0 && value <= UINT16_MAX){
+        pattern.segmentSize = value;
+        return true;
+    }
+    if(kind == "chain" && value > 0 && value <= 1460){
+        pattern.pbufSize = value;
+        return true;
+    }
+    if(kind == "random" && colon != string::npos){
+        pattern.segmentSize = 0;
+        pattern.seed = value;
+        return true;
+    }
+    return false;
+}
+
+PicoZmqHarness::PicoZmqHarness(PicoZmq::SocketTypes socketType, vector<string> topics): zmq("127.0.0.1", 5555, socketType), topics(std::move(topics)) {
+    reset();
+}
+
+void PicoZmqHarness::reset() {
+    zmq.connected = false;
+    zmq.settingUpTcpPcb();
+    droppedAtReset = zmq.getDroppedFrames();
+    res = {};
+    messages.clear();
+}
+
+PicoZmqHarness::result PicoZmqHarness::replay(const uint8_t *data, size_t len, const splitPattern &pattern) {
+    reset();
+    mt19937 random(pattern.seed);
+    uniform_int_distribution<uint16_t> randomSize(1, 1460);
+    size_t offset = 0;
+    while (offset < len){
+        size_t size = pattern.segmentSize ? pattern.segmentSize : randomSize(random);
+        size = size < len - offset ? size : len - offset;
+        segment(data + offset, size, pattern.pbufSize);
+        offset += size;
+    }
+    return res;
+}
+
+bool PicoZmqHarness::handshake(const string &serverType) {
+    reset();
+    vector<uint8_t> data = handshakeBytes(serverType);
+    segment(data.data(), data.size(), 0);
+    return zmq.isConnected();
+}
+
+void PicoZmqHarness::reconnect(const string &serverType) {
+    vector<uint8_t> data = handshakeBytes(serverType);
+    stub.onConnect = [this, &data](struct tcp_pcb *){deliver(data.data(), data.size(), 0);};
+    disconnect();
+    zmq.reconnect();
+    stub.onConnect = nullptr;
+}
+
+void PicoZmqHarness::disconnect() {
+    zmq.connected = false;
+}
+
+vector<uint8_t> PicoZmqHarness::handshakeBytes(const string &serverType) {
+    vector<uint8_t> data(64, 0x00);
+    data[0] = 0xFF; data[9] = 0x7F; data[10] = 0x03; data[11] = 0x01;
+    data[12] = 'N'; data[13] = 'U'; data[14] = 'L'; data[15] = 'L';
+    const string ready = "\x05READY\x0bSocket-Type";
+    data.push_back(0x04);
+    data.push_back(ready.size() + 4 + serverType.size());
+    data.insert(data.end(), ready.begin(), ready.end());
+    data.insert(data.end(), {0, 0, 0, (uint8_t) serverType.size()});
+    data.insert(data.end(), serverType.begin(), serverType.end());
+    return data;
+}
+
+#if LATENCY_TRACE
+void PicoZmqHarness::acknowledge(u16_t len) {
+    zmq.tcp_pcb->lastack += len;
+    PicoZmq::tcp_client_sent(&zmq.tcp_data, zmq.tcp_pcb, len);
+}
+#endif
+
+void PicoZmqHarness::segment(const uint8_t *data, uint16_t len, uint16_t pbufSize) {
+    deliver(data, len, pbufSize);
+    pump();
+}
+
+void PicoZmqHarness::deliver(const uint8_t *data, uint16_t len, uint16_t pbufSize) {
+    if(len == 0){
+        return;
+    }
+    uint16_t size = pbufSize ? pbufSize : len;
+    chain.resize((len + size - 1) / size);
+    for (size_t i = 0; i < chain.size(); ++i) {
+        uint16_t offset = i * size;
+        chain[i].next = i + 1 < chain.size() ? &chain[i + 1] : nullptr;
+        chain[i].payload = (void*) (data + offset);
+        chain[i].len = size < len - offset ? size : len - offset;
+        chain[i].tot_len = len - offset;
+    }
+    PicoZmq::tcp_client_recv(&zmq.tcp_data, zmq.tcp_pcb, chain.data(), ERR_OK);
+}
+
+void PicoZmqHarness::pump() {
+    if(!zmq.connected){
+        if(queue_get_level(&zmq.receive_queue) < 2 || zmq.connectToZmq() != ERR_OK){
+            return;
+        }
+        res.connected = true;
+        zmq.subscribe(topics);
+    }
+    while (zmq.gotMessage()){
+        PicoZmq::returnMessage message = zmq.getMessage();
+        if(!message.matched){
+            continue;
+        }
+        res.messages ++;
+        uint64_t hash = res.checksum ? res.checksum : 0xcbf29ce484222325;
+        hash = (hash ^ message.topicID) * 0x100000001b3;
+        for (char c: message.payload) {
+            hash = (hash ^ (uint8_t) c) * 0x100000001b3;
+        }
+        hash = (hash ^ message.payload.size()) * 0x100000001b3;
+        res.checksum = hash;
+        if(keep_messages){
+            messages.push_back(message);
+        }
+    }
+    res.dropped = zmq.getDroppedFrames() - droppedAtReset;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file Host harness that replays ZMTP byte streams into PicoZmq
+ */
+
+#ifndef PICOZMQ_TEST_HARNESS_H
+#define PICOZMQ_TEST_HARNESS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PicoZmq.h"
+
+/**
+ * @brief Description of how a byte stream is split in tcp segments and pbuf chains
+ */
+struct splitPattern{
+    string name;                /**< name used in reports */
+    uint16_t segmentSize;       /**< bytes per tcp segment, 0 for random sizes up to one MSS */
+    uint16_t pbufSize;          /**< bytes per pbuf in the chain of a segment, 0 for a single pbuf */
+    uint32_t seed;              /**< seed for random segment sizes */
+
+    /**
+     * Parse a pattern: mss, bytes, fixed:N, chain:N or random:SEED
+     * @param text pattern to parse
+     * @param pattern struct to put the result in
+     * @return true when the pattern is valid
+     */
+    static bool parse(const string &text, splitPattern &pattern);
+};
+
+/**
+ * @brief Feeds byte streams through PicoZmq::tcp_client_recv and consumes the result like an application loop
+ */
+class PicoZmqHarness{
+public:
+    /**
+     * Struct containing the outcome of a replay
+     */
+    struct result{
+        bool connected;         /**< whether the handshake succeeded */
+        size_t messages;        /**< number of messages getMessage matched to a subscribed topic */
+        uint32_t dropped;       /**< number of frames dropped by the decoder */
+        uint64_t checksum;      /**< FNV-1a hash over topic IDs and payloads of all messages */
+    };
+
+    /**
+     * @param socketType socket type of the PicoZmq client
+     * @param topics topics to subscribe to after the handshake
+     */
+    PicoZmqHarness(PicoZmq::SocketTypes socketType, vector<string> topics);
+
+    /**
+     * Start a new connection, the next bytes are expected to start with the greeting
+     */
+    void reset();
+
+    /**
+     * Reset and replay a whole stream
+     * @param data stream to replay
+     * @param len length of the stream
+     * @param pattern how to split the stream
+     * @return outcome of the replay
+     */
+    result replay(const uint8_t *data, size_t len, const splitPattern &pattern);
+
+    /**
+     * Reset and receive the greeting and ready of a server
+     * @param serverType socket type the server announces
+     * @return whether the socket is connected afterwards
+     */
+    bool handshake(const string &serverType);
+
+    /**
+     * Mark the socket disconnected and call PicoZmq::reconnect, the server handshake is delivered when it connects
+     * @param serverType socket type the server announces
+     */
+    void reconnect(const string &serverType);
+
+    /**
+     * Mark the socket disconnected, like a tcp error does
+     */
+    void disconnect();
+
+    /**
+     * @return time in us reconnect waits before the next attempt
+     */
+    [[nodiscard]] uint64_t reconnectTimeout() const{return zmq.reconnectTimeout;}
+
+    /**
+     * @return number of failed reconnect attempts in sequence
+     */
+    [[nodiscard]] uint16_t reconnectCount() const{return zmq.reconnectCount;}
+
+#if LATENCY_TRACE
+    /**
+     * Acknowledge sent bytes and call the sent callback
+     * @param len number of bytes acknowledged by the server
+     */
+    void acknowledge(u16_t len);
+
+    /**
+     * add a latency sample to a histogram
+     * @param hist histogram to add the sample to
+     * @param start time in us the stage started
+     * @param end time in us the stage ended
+     */
+    static void recordLatency(PicoZmq::latencyHistogram &hist, uint64_t start, uint64_t end){PicoZmq::recordLatency(hist, start, end);}
+#endif
+
+    /**
+     * Deliver one tcp segment to the receive callback and process all complete messages
+     * @param data bytes of the segment
+     * @param len length of the segment
+     * @param pbufSize bytes per pbuf in the chain, 0 for a single pbuf
+     */
+    void segment(const uint8_t *data, uint16_t len, uint16_t pbufSize);
+
+    /**
+     * @return outcome since the last reset
+     */
+    [[nodiscard]] const result &getResult() const{return res;}
+
+    /**
+     * Keep the messages returned by getMessage instead of only hashing them
+     * @param keep whether to keep the messages
+     */
+    void keepMessages(bool keep){keep_messages = keep;}
+
+    /**
+     * @return messages kept since the last reset
+     */
+    [[nodiscard]] const vector<PicoZmq::returnMessage> &getMessages() const{return messages;}
+
+    /**
+     * @return socket under test
+     */
+    PicoZmq &socket(){return zmq;}
+
+    /**
+     * @return stub tcp pcb of the current connection
+     */
+    struct tcp_pcb *pcb(){return zmq.tcp_pcb;}
+
+private:
+    /**
+     * Build the greeting and ready of a server
+     * @param serverType socket type the server announces
+     * @return handshake bytes
+     */
+    static vector<uint8_t> handshakeBytes(const string &serverType);
+
+    /**
+     * Deliver one tcp segment to the receive callback
+     * @param data bytes of the segment
+     * @param len length of the segment
+     * @param pbufSize bytes per pbuf in the chain, 0 for a single pbuf
+     */
+    void deliver(const uint8_t *data, uint16_t len, uint16_t pbufSize);
+
+    /**
+     * Finish the handshake when the greeting and ready are received and read all queued messages
+     */
+    void pump();
+
+    /// socket under test
+    PicoZmq zmq;
+    /// topics to subscribe to
+    vector<string> topics;
+    /// outcome since the last reset
+    result res{};
+    /// dropped frames of the socket at the last reset
+    uint32_t droppedAtReset = 0;
+    /// pbufs of the current segment
+    vector<struct pbuf> chain;
+    /// whether to keep the returned messages
+    bool keep_messages = false;
+    /// messages kept since the last reset
+    vector<PicoZmq::returnMessage> messages;
+};
+
+#endif //PICOZMQ_TEST_HARNESS_H
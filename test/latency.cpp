@@ -0,0 +1,75 @@
+/**
+ * @file Checks the latency histograms of PicoZmq, built with LATENCY_TRACE
+ */
+
+#include <cstdio>
+#include "harness.h"
+
+#define CHECK(condition) if(!(condition)){fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); return 1;}
+
+int main() {
+    // bucket 0 holds 0 us, bucket i holds [2^(i-1), 2^i) us, bucket 31 holds everything from 2^30 us
+    PicoZmq::latencyHistogram hist{};
+    const struct {uint64_t latency; uint8_t bucket;} samples[] = {
+            {0, 0}, {1, 1}, {2, 2}, {3, 2}, {4, 3}, {7, 3}, {8, 4}, {1023, 10}, {1024, 11},
+            {(1ULL << 30) - 1, 30}, {1ULL << 30, 31}, {1ULL << 31, 31}, {1ULL << 40, 31},
+    };
+    for (auto &sample: samples) {
+        PicoZmq::latencyHistogram before = hist;
+        PicoZmqHarness::recordLatency(hist, 1000, 1000 + sample.latency);
+        CHECK(hist.buckets[sample.bucket] == before.buckets[sample.bucket] + 1);
+    }
+    CHECK(hist.count == sizeof(samples) / sizeof(samples[0]));
+    CHECK(hist.buckets[31] == 3);
+    CHECK(hist.max == UINT32_MAX);
+    CHECK(hist.total == 0 + 1 + 2 + 3 + 4 + 7 + 8 + 1023 + 1024 + ((1ULL << 30) - 1) + (1ULL << 30) + (1ULL << 31) + (1ULL << 40));
+
+    PicoZmqHarness harness(PicoZmq::PUB, {});
+    PicoZmq &zmq = harness.socket();
+    CHECK(harness.handshake("SUB"));
+    // the ready message is not traced
+    harness.acknowledge(harness.pcb()->snd_lbb - harness.pcb()->lastack);
+    CHECK(zmq.getLatency(PicoZmq::SEND_ACK).count == 0);
+    zmq.resetLatency();
+
+    // receive side, every frame is queued and removed once
+    const uint8_t frames[] = {0x00, 0x02, 'h', 'i', 0x00, 0x01, '!'};
+    harness.segment(frames, sizeof(frames), 0);
+    CHECK(zmq.getLatency(PicoZmq::RECV_TO_ENQUEUE).count == 2);
+    CHECK(zmq.getLatency(PicoZmq::QUEUE_WAIT).count == 2);
+    CHECK(zmq.getLatency(PicoZmq::RECV_TO_ENQUEUE).max < 1000);
+
+    // send side, only writes covered by lastack are completed
+    CHECK(zmq.sendMessage(string("one")) == ERR_OK);
+    CHECK(zmq.sendMessage(string("two")) == ERR_OK);
+    CHECK(zmq.sendMessage(string("three")) == ERR_OK);
+    CHECK(zmq.getLatency(PicoZmq::SEND_WRITE).count == 3);
+    CHECK(zmq.getLatency(PicoZmq::SEND_ACK).count == 0);
+    sleep_ms(5);
+    harness.acknowledge(2 + 3);
+    PicoZmq::latencyHistogram ack = zmq.getLatency(PicoZmq::SEND_ACK);
+    CHECK(ack.count == 1);
+    CHECK(ack.max >= 5000 && ack.max < 8192);
+    CHECK(ack.buckets[13] == 1);
+    harness.acknowledge(2 + 3 - 1);
+    CHECK(zmq.getLatency(PicoZmq::SEND_ACK).count == 1);
+    harness.acknowledge(1 + 2 + 5);
+    CHECK(zmq.getLatency(PicoZmq::SEND_ACK).count == 3);
+
+    // at most LATENCY_TRACE_PENDING writes wait for an acknowledgement, later ones are not timed
+    for (int i = 0; i < LATENCY_TRACE_PENDING + 2; ++i) {
+        CHECK(zmq.sendMessage(string("x")) == ERR_OK);
+    }
+    harness.acknowledge((LATENCY_TRACE_PENDING + 2) * 3);
+    CHECK(zmq.getLatency(PicoZmq::SEND_ACK).count == 3 + LATENCY_TRACE_PENDING);
+    CHECK(zmq.getLatency(PicoZmq::SEND_WRITE).count == 3 + LATENCY_TRACE_PENDING + 2);
+
+    zmq.resetLatency();
+    for (uint8_t stage = 0; stage < PicoZmq::LATENCY_STAGES; ++stage) {
+        PicoZmq::latencyHistogram cleared = zmq.getLatency((PicoZmq::LatencyStages) stage);
+        CHECK(cleared.count == 0 && cleared.max == 0 && cleared.total == 0 && cleared.buckets[0] == 0);
+    }
+
+    puts("ok");
+    return 0;
+}
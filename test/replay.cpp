@@ -0,0 +1,110 @@
+/**
+ * @file Replay captured ZMTP streams into PicoZmq with different segmentation and report decoder throughput
+ *
+ * usage: picozmq_replay [--type SUB|PULL] [--topic TOPIC]... [--split PATTERN]... [--iterations N]
+ *                       [--expect MESSAGES] [--expect-dropped FRAMES] capture
+ *
+ * Every split pattern must decode the same messages, otherwise the replay fails.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include "harness.h"
+
+static int usage() {
+    fprintf(stderr, "usage: picozmq_replay [--type SUB|PULL] [--topic TOPIC]... [--split mss|bytes|fixed:N|chain:N|random:SEED]...\n"
+                    "                      [--iterations N] [--expect MESSAGES] [--expect-dropped FRAMES] capture\n");
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    PicoZmq::SocketTypes socketType = PicoZmq::SUB;
+    vector<string> topics;
+    vector<splitPattern> patterns;
+    unsigned long iterations = 1;
+    long expectMessages = -1;
+    long expectDropped = -1;
+    string path;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--type" && hasValue){
+            string type = argv[++i];
+            if(type == "SUB"){socketType = PicoZmq::SUB;}
+            else if(type == "PULL"){socketType = PicoZmq::PULL;}
+            else{return usage();}
+        }
+        else if(arg == "--topic" && hasValue){topics.emplace_back(argv[++i]);}
+        else if(arg == "--split" && hasValue){
+            splitPattern pattern;
+            if(!splitPattern::parse(argv[++i], pattern)){return usage();}
+            patterns.push_back(pattern);
+        }
+        else if(arg == "--iterations" && hasValue){iterations = strtoul(argv[++i], nullptr, 10);}
+        else if(arg == "--expect" && hasValue){expectMessages = strtol(argv[++i], nullptr, 10);}
+        else if(arg == "--expect-dropped" && hasValue){expectDropped = strtol(argv[++i], nullptr, 10);}
+        else if(path.empty() && arg[0] != '-'){path = arg;}
+        else{return usage();}
+    }
+    if(path.empty() || iterations == 0){
+        return usage();
+    }
+    if(topics.empty()){
+        topics.emplace_back("");
+    }
+    if(patterns.empty()){
+        for (const char *text: {"mss", "bytes", "fixed:7", "fixed:64", "chain:16", "random:1"}) {
+            splitPattern pattern;
+            splitPattern::parse(text, pattern);
+            patterns.push_back(pattern);
+        }
+    }
+
+    ifstream file(path, ios::binary);
+    vector<uint8_t> stream((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if(stream.empty()){
+        fprintf(stderr, "could not read %s\n", path.c_str());
+        return 2;
+    }
+
+    PicoZmqHarness harness(socketType, topics);
+    bool failed = false;
+    PicoZmqHarness::result reference{};
+    printf("%s: %zu bytes, %lu iterations\n", path.c_str(), stream.size(), iterations);
+    printf("build: %s\n", PICOZMQ_BUILD_INFO);
+    printf("%-12s %9s %8s %10s %10s %12s\n", "split", "messages", "dropped", "checksum", "MB/s", "messages/s");
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        PicoZmqHarness::result res{};
+        auto start = chrono::steady_clock::now();
+        for (unsigned long j = 0; j < iterations; ++j) {
+            res = harness.replay(stream.data(), stream.size(), patterns[i]);
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        printf("%-12s %9zu %8u %10.8llx %10.2f %12.0f\n", patterns[i].name.c_str(), res.messages, res.dropped,
+               (unsigned long long) (res.checksum & 0xffffffff), stream.size() * iterations / seconds / 1e6, res.messages * iterations / seconds);
+
+        if(!res.connected){
+            fprintf(stderr, "%s: handshake failed\n", patterns[i].name.c_str());
+            failed = true;
+        }
+        if(i == 0){
+            reference = res;
+        }
+        else if(res.messages != reference.messages || res.dropped != reference.dropped || res.checksum != reference.checksum){
+            fprintf(stderr, "%s: decoded different messages than %s\n", patterns[i].name.c_str(), patterns[0].name.c_str());
+            failed = true;
+        }
+    }
+    if(expectMessages >= 0 && reference.messages != (size_t) expectMessages){
+        fprintf(stderr, "expected %ld messages, got %zu\n", expectMessages, reference.messages);
+        failed = true;
+    }
+    if(expectDropped >= 0 && reference.dropped != (uint32_t) expectDropped){
+        fprintf(stderr, "expected %ld dropped frames, got %u\n", expectDropped, reference.dropped);
+        failed = true;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file Host stub of the lwIP pbuf API used by PicoZmq
+ */
+
+#ifndef PICOZMQ_STUB_LWIP_PBUF_H
+#define PICOZMQ_STUB_LWIP_PBUF_H
+
+#include <cstdint>
+#include <cstring>
+
+typedef int8_t err_t;
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+
+#define ERR_OK 0
+#define ERR_MEM (-1)
+#define ERR_TIMEOUT (-3)
+#define ERR_VAL (-6)
+#define ERR_CONN (-11)
+#define ERR_ABRT (-13)
+
+/// pbuf chain, payload is owned by the harness
+struct pbuf{
+    struct pbuf *next;
+    void *payload;
+    u16_t tot_len;
+    u16_t len;
+};
+
+u16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, u16_t len, u16_t offset);
+u8_t pbuf_free(struct pbuf *p);
+
+#endif //PICOZMQ_STUB_LWIP_PBUF_H
@@ -0,0 +1,55 @@
+/**
+ * @file Host stub of the lwIP raw tcp API used by PicoZmq
+ */
+
+#ifndef PICOZMQ_STUB_LWIP_TCP_H
+#define PICOZMQ_STUB_LWIP_TCP_H
+
+#include "lwip/pbuf.h"
+
+#define TCP_WRITE_FLAG_COPY 0x01
+#define TCP_WRITE_FLAG_MORE 0x02
+#define TCP_SND_QUEUELEN 16
+#define IP_GET_TYPE(ipaddr) 0
+
+struct ip_addr_t{
+    u32_t addr;
+};
+
+/// tcp pcb, the send buffer never fills and lastack only moves when a test acknowledges data
+struct tcp_pcb{
+    u32_t lastack;
+    u32_t snd_lbb;
+    u16_t snd_buf;
+    u16_t snd_queuelen;
+    u32_t written;          /// total bytes passed to tcp_write
+    u32_t writes;           /// number of successful tcp_write calls
+    u32_t outputs;          /// number of tcp_output calls
+};
+
+#define tcp_sndbuf(pcb) ((pcb)->snd_buf)
+#define tcp_sndqueuelen(pcb) ((pcb)->snd_queuelen)
+
+typedef err_t (*tcp_recv_fn)(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err);
+typedef err_t (*tcp_sent_fn)(void *arg, struct tcp_pcb *tpcb, u16_t len);
+typedef err_t (*tcp_poll_fn)(void *arg, struct tcp_pcb *tpcb);
+typedef void (*tcp_err_fn)(void *arg, err_t err);
+typedef err_t (*tcp_connected_fn)(void *arg, struct tcp_pcb *tpcb, err_t err);
+
+struct tcp_pcb *tcp_new_ip_type(u8_t type);
+err_t tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port, tcp_connected_fn connected);
+err_t tcp_write(struct tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags);
+err_t tcp_output(struct tcp_pcb *pcb);
+err_t tcp_close(struct tcp_pcb *pcb);
+void tcp_abort(struct tcp_pcb *pcb);
+void tcp_recved(struct tcp_pcb *pcb, u16_t len);
+void tcp_arg(struct tcp_pcb *pcb, void *arg);
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv);
+void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent);
+void tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval);
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err);
+
+int ip4addr_aton(const char *cp, ip_addr_t *addr);
+char *ip4addr_ntoa(const ip_addr_t *addr);
+
+#endif //PICOZMQ_STUB_LWIP_TCP_H
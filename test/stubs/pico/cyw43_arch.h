@@ -0,0 +1,21 @@
+/**
+ * @file Host stub of the pico cyw43 and time API used by PicoZmq
+ */
+
+#ifndef PICOZMQ_STUB_PICO_CYW43_ARCH_H
+#define PICOZMQ_STUB_PICO_CYW43_ARCH_H
+
+#include <cstdint>
+
+#define CYW43_WL_GPIO_LED_PIN 0
+
+void cyw43_arch_lwip_begin();
+void cyw43_arch_lwip_end();
+void cyw43_arch_lwip_check();
+void cyw43_arch_gpio_put(uint32_t wl_gpio, bool value);
+
+/// host time in us, sleep_ms advances it without waiting
+uint64_t time_us_64();
+void sleep_ms(uint32_t ms);
+
+#endif //PICOZMQ_STUB_PICO_CYW43_ARCH_H
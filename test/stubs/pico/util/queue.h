@@ -0,0 +1,26 @@
+/**
+ * @file Host stub of the pico queue used by PicoZmq
+ */
+
+#ifndef PICOZMQ_STUB_PICO_UTIL_QUEUE_H
+#define PICOZMQ_STUB_PICO_UTIL_QUEUE_H
+
+#include <cstdint>
+
+/// single threaded ring buffer with the same interface as the pico queue
+struct queue_t{
+    uint8_t *data;
+    uint32_t element_size;
+    uint32_t element_count;
+    uint32_t head;
+    uint32_t level;
+};
+
+void queue_init(queue_t *q, unsigned int element_size, unsigned int element_count);
+void queue_free(queue_t *q);
+bool queue_is_empty(queue_t *q);
+unsigned int queue_get_level(queue_t *q);
+bool queue_try_add(queue_t *q, const void *data);
+bool queue_try_remove(queue_t *q, void *data);
+
+#endif //PICOZMQ_STUB_PICO_UTIL_QUEUE_H
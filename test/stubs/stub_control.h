@@ -0,0 +1,23 @@
+/**
+ * @file Control of the host stubs by the harness and tests
+ */
+
+#ifndef PICOZMQ_STUB_CONTROL_H
+#define PICOZMQ_STUB_CONTROL_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "lwip/tcp.h"
+
+/// state shared between the stubs and the tests
+struct stubControl{
+    std::vector<uint8_t> written;                       /// all bytes passed to tcp_write
+    int32_t writeLimit = -1;                            /// number of tcp_write calls that still succeed, -1 for unlimited
+    uint32_t connects = 0;                              /// number of tcp_connect calls
+    std::function<void(struct tcp_pcb *pcb)> onConnect; /// called by tcp_connect, e.g. to deliver the server handshake
+};
+
+extern stubControl stub;
+
+#endif //PICOZMQ_STUB_CONTROL_H
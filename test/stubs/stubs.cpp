@@ -0,0 +1,135 @@
+/**
+ * @file Host implementation of the lwIP and pico stubs used by PicoZmq
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+#include "pico/util/queue.h"
+#include "pico/cyw43_arch.h"
+#include "stub_control.h"
+
+stubControl stub;
+
+static uint64_t sleptUs = 0;
+static struct tcp_pcb pcb{};
+
+u16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, u16_t len, u16_t offset) {
+    u16_t copied = 0;
+    for (const struct pbuf *q = p; q != nullptr && len > 0; q = q->next) {
+        if(offset >= q->len){
+            offset -= q->len;
+            continue;
+        }
+        u16_t size = q->len - offset < len ? q->len - offset : len;
+        memcpy((uint8_t*) dataptr + copied, (uint8_t*) q->payload + offset, size);
+        copied += size;
+        len -= size;
+        offset = 0;
+    }
+    return copied;
+}
+
+u8_t pbuf_free(struct pbuf *) {return 1;}
+
+struct tcp_pcb *tcp_new_ip_type(u8_t) {
+    pcb = {};
+    pcb.snd_buf = 2 * 1460;
+    return &pcb;
+}
+
+err_t tcp_connect(struct tcp_pcb *tpcb, const ip_addr_t *, u16_t, tcp_connected_fn) {
+    stub.connects ++;
+    if(stub.onConnect){
+        stub.onConnect(tpcb);
+    }
+    return ERR_OK;
+}
+
+err_t tcp_write(struct tcp_pcb *tpcb, const void *dataptr, u16_t len, u8_t) {
+    if(len > tcp_sndbuf(tpcb) || tcp_sndqueuelen(tpcb) >= TCP_SND_QUEUELEN || stub.writeLimit == 0){
+        return ERR_MEM;
+    }
+    if(stub.writeLimit > 0){
+        stub.writeLimit --;
+    }
+    stub.written.insert(stub.written.end(), (const uint8_t*) dataptr, (const uint8_t*) dataptr + len);
+    tpcb->snd_lbb += len;
+    tpcb->written += len;
+    tpcb->writes ++;
+    return ERR_OK;
+}
+
+err_t tcp_output(struct tcp_pcb *tpcb) {
+    tpcb->outputs ++;
+    return ERR_OK;
+}
+
+err_t tcp_close(struct tcp_pcb *) {return ERR_OK;}
+void tcp_abort(struct tcp_pcb *) {}
+void tcp_recved(struct tcp_pcb *, u16_t) {}
+void tcp_arg(struct tcp_pcb *, void *) {}
+void tcp_recv(struct tcp_pcb *, tcp_recv_fn) {}
+void tcp_sent(struct tcp_pcb *, tcp_sent_fn) {}
+void tcp_poll(struct tcp_pcb *, tcp_poll_fn, u8_t) {}
+void tcp_err(struct tcp_pcb *, tcp_err_fn) {}
+
+int ip4addr_aton(const char *, ip_addr_t *addr) {
+    addr->addr = 0x0100007F;
+    return 1;
+}
+
+char *ip4addr_ntoa(const ip_addr_t *) {
+    static char address[] = "127.0.0.1";
+    return address;
+}
+
+void queue_init(queue_t *q, unsigned int element_size, unsigned int element_count) {
+    q->data = (uint8_t*) calloc(element_count, element_size);
+    q->element_size = element_size;
+    q->element_count = element_count;
+    q->head = 0;
+    q->level = 0;
+}
+
+void queue_free(queue_t *q) {
+    free(q->data);
+    q->data = nullptr;
+}
+
+bool queue_is_empty(queue_t *q) {return q->level == 0;}
+
+unsigned int queue_get_level(queue_t *q) {return q->level;}
+
+bool queue_try_add(queue_t *q, const void *data) {
+    if(q->level == q->element_count){
+        return false;
+    }
+    uint32_t index = (q->head + q->level) % q->element_count;
+    memcpy(q->data + index * q->element_size, data, q->element_size);
+    q->level ++;
+    return true;
+}
+
+bool queue_try_remove(queue_t *q, void *data) {
+    if(q->level == 0){
+        return false;
+    }
+    memcpy(data, q->data + q->head * q->element_size, q->element_size);
+    q->head = (q->head + 1) % q->element_count;
+    q->level --;
+    return true;
+}
+
+void cyw43_arch_lwip_begin() {}
+void cyw43_arch_lwip_end() {}
+void cyw43_arch_lwip_check() {}
+void cyw43_arch_gpio_put(uint32_t, bool) {}
+
+uint64_t time_us_64() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count() + sleptUs;
+}
+
+void sleep_ms(uint32_t ms) {sleptUs += ms * 1000;}
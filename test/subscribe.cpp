@@ -0,0 +1,135 @@
+/**
+ * @file Checks the subscription commands on the wire and topic matching of PicoZmq
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include "harness.h"
+#include "stub_control.h"
+
+#define CHECK(condition) if(!(condition)){fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); return 1;}
+
+static vector<uint8_t> frame(const string &message) {
+    vector<uint8_t> data = {0x00, (uint8_t) message.size()};
+    data.insert(data.end(), message.begin(), message.end());
+    return data;
+}
+
+static vector<uint8_t> command(const string &name, const vector<string> &topics) {
+    vector<uint8_t> data;
+    for (auto &topic: topics) {
+        data.insert(data.end(), {0x04, (uint8_t) (1 + name.size() + topic.size()), (uint8_t) name.size()});
+        data.insert(data.end(), name.begin(), name.end());
+        data.insert(data.end(), topic.begin(), topic.end());
+    }
+    return data;
+}
+
+/// topics of all short commands with the given name in the written bytes, sorted
+static vector<string> commandTopics(const vector<uint8_t> &written, const string &name) {
+    vector<string> topics;
+    for (size_t offset = 0; offset + 2 <= written.size(); offset += 2 + written[offset + 1]) {
+        const uint8_t *body = written.data() + offset + 2;
+        if(written[offset] == 0x04 && body[0] == name.size() && string(body + 1, body + 1 + name.size()) == name){
+            topics.emplace_back(body + 1 + name.size(), body + written[offset + 1]);
+        }
+    }
+    sort(topics.begin(), topics.end());
+    return topics;
+}
+
+int main() {
+    PicoZmqHarness harness(PicoZmq::SUB, {});
+    PicoZmq &zmq = harness.socket();
+    harness.keepMessages(true);
+    CHECK(harness.handshake("PUB"));
+
+    // duplicates are sent once, all commands in one output
+    stub.written.clear();
+    uint32_t outputs = harness.pcb()->outputs;
+    CHECK(zmq.subscribe(vector<string>{"a", "bb", "a"}) == ERR_OK);
+    CHECK(stub.written == command("SUBSCRIBE", {"a", "bb"}));
+    CHECK(harness.pcb()->outputs == outputs + 1);
+    CHECK(zmq.subscribe("a") == ERR_VAL);
+
+    // a batch larger than the send buffer is written in chunks with one output
+    vector<string> topics;
+    for (int i = 0; i < 200; ++i) {
+        topics.push_back("sensor/" + to_string(i) + "/" + string(20, 'x'));
+    }
+    stub.written.clear();
+    outputs = harness.pcb()->outputs;
+    uint32_t writes = harness.pcb()->writes;
+    CHECK(zmq.subscribe(topics) == ERR_OK);
+    CHECK(stub.written == command("SUBSCRIBE", topics));
+    CHECK(harness.pcb()->writes > writes + 1);
+    CHECK(harness.pcb()->outputs == outputs + 1);
+
+    // single and batch unsubscribe send CANCEL, topics that are not subscribed are skipped
+    stub.written.clear();
+    CHECK(zmq.unsubscribe("a") == ERR_OK);
+    CHECK(stub.written == command("CANCEL", {"a"}));
+    CHECK(zmq.unsubscribe("a") == ERR_VAL);
+    stub.written.clear();
+    vector<string> cancel = topics;
+    cancel.insert(cancel.end(), {"bb", "missing", "bb"});
+    CHECK(zmq.unsubscribe(cancel) == ERR_OK);
+    vector<string> cancelled = topics;
+    cancelled.emplace_back("bb");
+    CHECK(stub.written == command("CANCEL", cancelled));
+
+    // commands longer than 255 bytes are refused before anything is written, also when the length exceeds 16 bits
+    stub.written.clear();
+    CHECK(zmq.subscribe(string(255 - 9, 't')) == ERR_VAL);
+    CHECK(zmq.subscribe(string(65536 - 10 + 5, 't')) == ERR_VAL);
+    CHECK(stub.written.empty());
+
+    // longest subscribed prefix wins, messages without a subscribed topic are not matched
+    CHECK(zmq.subscribe(vector<string>{"weather", "weather/temp", "news"}) == ERR_OK);
+    for (const char *message: {"weather/temp 21", "weather rain", "sports 1", "news"}) {
+        vector<uint8_t> data = frame(message);
+        harness.segment(data.data(), data.size(), 0);
+    }
+    const vector<PicoZmq::returnMessage> &messages = harness.getMessages();
+    CHECK(messages.size() == 3);
+    CHECK(messages[0].topicID == 1 && string(messages[0].payload.begin(), messages[0].payload.end()) == " 21");
+    CHECK(messages[1].topicID == 0 && string(messages[1].payload.begin(), messages[1].payload.end()) == " rain");
+    CHECK(messages[2].topicID == 2 && messages[2].payload.empty());
+
+    // topic IDs of unsubscribed topics are reused, lowest first
+    CHECK(zmq.unsubscribe("weather/temp") == ERR_OK);
+    CHECK(zmq.subscribe("weather/wind") == ERR_OK);
+    vector<uint8_t> data = frame("weather/wind 5");
+    harness.segment(data.data(), data.size(), 0);
+    CHECK(messages.size() == 4);
+    CHECK(messages[3].topicID == 1 && string(messages[3].payload.begin(), messages[3].payload.end()) == " 5");
+
+    // reconnect resubscribes to every topic
+    stub.written.clear();
+    harness.reconnect("PUB");
+    CHECK(zmq.isConnected());
+    CHECK(commandTopics(stub.written, "SUBSCRIBE") == vector<string>({"news", "weather", "weather/wind"}));
+    CHECK(harness.reconnectCount() == 0);
+
+    // a failed resubscribe disconnects and backs off before the next attempt
+    stub.writeLimit = 1;
+    harness.reconnect("PUB");
+    CHECK(!zmq.isConnected());
+    CHECK(harness.reconnectCount() == 1);
+    CHECK(harness.reconnectTimeout() >= RECONNECT_DEFAULT_TIMEOUT);
+    uint32_t connects = stub.connects;
+    zmq.reconnect();
+    CHECK(stub.connects == connects);
+
+    stub.writeLimit = -1;
+    sleep_ms(RECONNECT_DEFAULT_TIMEOUT / 1000 + 1);
+    stub.written.clear();
+    harness.reconnect("PUB");
+    CHECK(zmq.isConnected());
+    CHECK(stub.connects == connects + 1);
+    CHECK(harness.reconnectCount() == 0);
+    CHECK(commandTopics(stub.written, "SUBSCRIBE") == vector<string>({"news", "weather", "weather/wind"}));
+
+    puts("ok");
+    return 0;
+}